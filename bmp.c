@@ -0,0 +1,208 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+#include <string.h>
+#include "bmp.h"
+
+#define BI_RGB          0
+#define BI_BITFIELDS    3
+
+static int read_data( FILE *file, BMPIMAGE *image )
+{
+    size_t size = image->stride * image->height;
+    
+    image->data = scratch_alloc( size );
+    if( fread( image->data, 1, size, file ) != size )
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Works out where each channel sits so bmp_row() doesn't have to.
+static void set_masks( BMPIMAGE *image )
+{
+    for( int i = 0; i < 4; i++ )
+    {
+        uint32_t mask = image->masks[i];
+        image->shifts[i] = 0;
+        while( mask != 0 && (mask & 1) == 0 )
+        {
+            mask >>= 1;
+            image->shifts[i]++;
+        }
+        image->maxes[i] = mask;
+    }
+}
+
+// Scales one channel to 8 bits; an empty mask means fully opaque.
+static uint32_t channel( const BMPIMAGE *image, uint32_t pixel, int i )
+{
+    uint32_t value = (pixel & image->masks[i]) >> image->shifts[i];
+    if( image->maxes[i] == 0 )
+    {
+        return 0xff;
+    }
+    return (image->maxes[i] == 0xff)? value : (value * 255 + image->maxes[i] / 2) / image->maxes[i];
+}
+
+int read_bmp( FILE *file, BMPIMAGE *image )
+{
+    BMPHEADER header;
+    uint8_t masks[16];
+    size_t extra = 0;
+    
+    memset( image, 0, sizeof( BMPIMAGE ) );
+    if( fread( &header, sizeof( BMPHEADER ), 1, file ) != 1 )
+    {
+        fprintf( stderr, "Input file invalid.\n" );
+        return -1;
+    }
+    if( header.magic != 0x4d42 || header.headersize < 0x28
+        || header.offset < sizeof( BMPHEADER )
+        || header.width < 1 || header.width > MAX_DIMENSION
+        || header.height == 0 || header.height < -MAX_DIMENSION || header.height > MAX_DIMENSION
+        || header.planes != 1
+        || !(((header.bpp == 16 || header.bpp == 24 || header.bpp == 32) && header.compression == BI_RGB)
+            || ((header.bpp == 16 || header.bpp == 32) && header.compression == BI_BITFIELDS)) )
+    {
+        fprintf( stderr, "Input file unsupported or invalid.\n" );
+        return -1;
+    }
+    
+    image->width = header.width;
+    image->height = (header.height < 0)? -header.height : header.height;
+    image->topdown = header.height < 0;
+    image->bpp = header.bpp;
+    image->stride = ((size_t)image->width * header.bpp / 8 + 3) & ~(size_t)3;
+    switch( header.bpp )
+    {
+        case 16:
+            image->masks[0] = 0x7c00;
+            image->masks[1] = 0x03e0;
+            image->masks[2] = 0x001f;
+            break;
+        case 24:
+            image->masks[0] = 0xff0000;
+            image->masks[1] = 0xff00;
+            image->masks[2] = 0xff;
+            break;
+        default:
+            image->masks[0] = 0xff0000;
+            image->masks[1] = 0xff00;
+            image->masks[2] = 0xff;
+            image->masks[3] = 0xff000000;
+            break;
+    }
+    
+    if( header.compression == BI_BITFIELDS )
+    {
+        // the masks follow a plain info header, or are part of a V3 or later one;
+        // either way they start right after the fields in BMPHEADER
+        extra = (header.headersize >= 0x38)? 16 : 12;
+        if( header.offset - sizeof( BMPHEADER ) < extra || fread( masks, 1, extra, file ) != extra )
+        {
+            fprintf( stderr, "Input file unsupported or invalid.\n" );
+            return -1;
+        }
+        for( size_t i = 0; i < 4; i++ )
+        {
+            image->masks[i] = (i * 4 < extra)? (uint32_t)masks[i * 4 + 3] << 24 | masks[i * 4 + 2] << 16 | masks[i * 4 + 1] << 8 | masks[i * 4] : 0;
+        }
+    }
+    
+    set_masks( image );
+    
+    // skip forward instead of seeking so pipes work too
+    if( skip_input( file, header.offset - sizeof( BMPHEADER ) - extra ) )
+    {
+        fprintf( stderr, "Failed to read input file.\n" );
+        return -1;
+    }
+    if( read_data( file, image ) )
+    {
+        fprintf( stderr, "Error reading bitmap file.\n" );
+        return -1;
+    }
+    return 0;
+}
+
+int read_pixels( FILE *file, enum E_LAYOUT layout, int32_t width, int32_t height, BMPIMAGE *image )
+{
+    memset( image, 0, sizeof( BMPIMAGE ) );
+    image->width = width;
+    image->height = height;
+    image->topdown = 1;
+    image->bpp = 32;
+    image->stride = (size_t)width * 4;
+    // the masks describe the bytes as a little-endian word
+    if( layout == LAYOUT_ARGB )
+    {
+        image->masks[0] = 0x0000ff00;
+        image->masks[1] = 0x00ff0000;
+        image->masks[2] = 0xff000000;
+        image->masks[3] = 0x000000ff;
+    }
+    else
+    {
+        image->masks[0] = 0x000000ff;
+        image->masks[1] = 0x0000ff00;
+        image->masks[2] = 0x00ff0000;
+        image->masks[3] = 0xff000000;
+    }
+    set_masks( image );
+    if( read_data( file, image ) )
+    {
+        fprintf( stderr, "Error reading pixel stream.\n" );
+        return -1;
+    }
+    return 0;
+}
+
+// Row 0 is the top of the image.
+const uint32_t *bmp_row( const BMPIMAGE *image, int32_t y, uint32_t *scratch )
+{
+    const uint8_t *row = image->data + image->stride * (image->topdown? y : image->height - 1 - y);
+    const uint32_t *masks = image->masks;
+    uint32_t pixel;
+    
+    switch( image->bpp )
+    {
+        case 16:
+        {
+            for( int32_t x = 0; x < image->width; x++ )
+            {
+                pixel = row[x * 2] | row[x * 2 + 1] << 8;
+                scratch[x] = channel( image, pixel, 3 ) << 24 | channel( image, pixel, 0 ) << 16
+                    | channel( image, pixel, 1 ) << 8 | channel( image, pixel, 2 );
+            }
+            return scratch;
+        }
+        case 24:
+        {
+            for( int32_t x = 0; x < image->width; x++ )
+            {
+                scratch[x] = 0xff000000 | row[x * 3 + 2] << 16 | row[x * 3 + 1] << 8 | row[x * 3];
+            }
+            return scratch;
+        }
+        default:
+        {
+            if( masks[0] == 0xff0000 && masks[1] == 0xff00 && masks[2] == 0xff && masks[3] == 0xff000000 )
+            {
+                // already 0xAARRGGBB, and rows are a multiple of 4 bytes so they stay aligned
+                return (const uint32_t *)row;
+            }
+            for( int32_t x = 0; x < image->width; x++ )
+            {
+                pixel = (uint32_t)row[x * 4 + 3] << 24 | row[x * 4 + 2] << 16 | row[x * 4 + 1] << 8 | row[x * 4];
+                scratch[x] = channel( image, pixel, 3 ) << 24 | channel( image, pixel, 0 ) << 16
+                    | channel( image, pixel, 1 ) << 8 | channel( image, pixel, 2 );
+            }
+            return scratch;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+/* Reads images for import. BMP files can be bottom-up or top-down, and
+ * 16-bit (BI_RGB or BI_BITFIELDS), 24-bit or 32-bit (BI_RGB or
+ * BI_BITFIELDS). Raw ARGB/RGBA pixel streams are read the same way.
+ * The pixel array is kept as it was read; bmp_row() hands out one row
+ * at a time as 0xAARRGGBB pixels, converting into the scratch row only
+ * when the file isn't already in that layout.
+ */
+
+#ifndef BMP_H
+#define BMP_H
+
+#include <stdio.h>
+#include "cli.h"
+
+typedef struct {
+    uint8_t *data;
+    int32_t width;
+    int32_t height;
+    size_t stride;          // bytes per row in data
+    int topdown;
+    uint16_t bpp;
+    uint32_t masks[4];      // red, green, blue, alpha (0 for opaque)
+    uint8_t shifts[4];      // filled in from masks
+    uint32_t maxes[4];
+} BMPIMAGE;
+
+int read_bmp( FILE *file, BMPIMAGE *image );
+int read_pixels( FILE *file, enum E_LAYOUT layout, int32_t width, int32_t height, BMPIMAGE *image );
+const uint32_t *bmp_row( const BMPIMAGE *image, int32_t y, uint32_t *scratch );
+
+#endif
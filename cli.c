@@ -8,10 +8,30 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "bmp.h"
 #include "cli.h"
+#include "dedup.h"
+#include "dlist.h"
+#include "index.h"
 #include "n64rawgfx.h"
 
+const char *const format_names[] = { "RGBA", "YUV", "CI", "IA", "I" };
+
+// Conversion buffers come from here. Each conversion resets it first, so
+// nothing allocated from it needs to be freed.
+N64_ARENA scratch;
+
+// Palettes already decoded in this run, reused in round-robin order once full.
+PALETTE palettes[PALETTE_CACHE_SIZE];
+size_t palettes_used = 0;
+size_t palettes_next = 0;
+
 void __attribute__((noreturn)) print_help( const char* const name )
 {
     fprintf( stderr,
@@ -20,16 +40,32 @@ void __attribute__((noreturn)) print_help( const char* const name )
         "Options:\n"
         "  -h         --help             Show this help\n"
         "  -r <file>  --romfile <file>   Export from/import to ROM file\n"
-        "  -b <file>  --bmpfile <file>   Export to/import from BMP file\n"
-        "  -m <mode>  --mode <mode>      Mode (export, import)\n"
+        "  -b <file>  --bmpfile <file>   Export to/import from BMP file (\"-\" for stdout/stdin)\n"
+        "  -p <fmt>   --pixels <fmt>     Pixel stream (BMP, ARGB, RGBA)\n"
+        "  -m <mode>  --mode <mode>      Mode (export, import, walk, dedup, list)\n"
         "  -f <fmt>   --format <fmt>     Format (RGBA, CI, IA, I)\n"
 //      "  -f <fmt>   --format <fmt>     Format (RGBA, YUV, CI, IA, I)\n"
         "  -d <bits>  --depth <bits>     Bit depth (4, 8, 16, 32)\n"
         "  -a <addr>  --address <addr>   Address (use \"0x\" for hexadecimal)\n"
-        "  -x <num>   --width <num>      Width (export only)\n"
-        "  -y <num>   --height <num>     Height (export only)\n"
+        "                                (export: a comma-separated list exports each)\n"
+        "                                (walk: ROM address of the display list)\n"
+        "                                (dedup: first address to scan)\n"
+        "  -x <num>   --width <num>      Width (export, dedup, ARGB/RGBA import)\n"
+        "  -y <num>   --height <num>     Height (export, dedup, ARGB/RGBA import)\n"
         "             --pdepth <bits>    Palette depth (16, 32) (CI only)\n"
         "             --paddress <addr>  Palette address (CI only)\n"
+        "  -s <n>=<addr> --segment <n>=<addr>\n"
+        "                                Map segment n to a ROM address (walk, dedup)\n"
+        "             --dlist <addr>     Dedup textures from this display list (dedup only)\n"
+        "             --end <addr>       End of the scanned range (dedup only)\n"
+        "             --step <num>       Alignment of scanned addresses (dedup, fanout)\n"
+        "             --fanout           Also import to every copy of the texture (import only)\n"
+        "             --index <file>     Record textures in an index file (export, walk)\n"
+        "                                or read them from it (export, list)\n"
+        "             --id <num>         Export this index entry (export only)\n"
+        "             --src-width <num>  Width of the whole texture (with --crop)\n"
+        "             --crop <x,y,w,h>   Export/import only this rectangle of the texture\n"
+        "                                (w and h are optional for import)\n"
         "\n"
         "https://github.com/Octocontrabass\n", name );
     exit( EXIT_SUCCESS );
@@ -46,20 +82,487 @@ void *checked_malloc( size_t size )
     return ret;
 }
 
+void *scratch_alloc( size_t size )
+{
+    void *ret = n64_arena_alloc( &scratch, size );
+    if( ret == NULL )
+    {
+        fprintf( stderr, "Out of memory!\n" );
+        exit( EXIT_FAILURE );
+    }
+    return ret;
+}
+
+void *checked_realloc( void *ptr, size_t size )
+{
+    void *ret = realloc( ptr, size );
+    if( ret == NULL )
+    {
+        fprintf( stderr, "Out of memory!\n" );
+        exit( EXIT_FAILURE );
+    }
+    return ret;
+}
+
+FILE *binary_stdio( FILE *file )
+{
+#ifdef _WIN32
+    _setmode( _fileno( file ), _O_BINARY );
+#endif
+    return file;
+}
+
+// Pixels are 0xAARRGGBB internally, which is the byte order BMP uses.
+// Export uses this to put raw output in the requested byte order; raw input is
+// read through bmp_row() masks instead.
+void swizzle_pixels( enum E_LAYOUT layout, size_t count, uint32_t *buf )
+{
+    switch( layout )
+    {
+        case LAYOUT_ARGB:
+        {
+            for( size_t i = 0; i < count; i++ )
+            {
+                buf[i] = buf[i] << 24 | (buf[i] & 0xff00) << 8 | (buf[i] & 0xff0000) >> 8 | buf[i] >> 24;
+            }
+            break;
+        }
+        case LAYOUT_RGBA:
+        {
+            for( size_t i = 0; i < count; i++ )
+            {
+                buf[i] = (buf[i] & 0xff00ff00) | (buf[i] & 0xff0000) >> 16 | (buf[i] & 0xff) << 16;
+            }
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+    return;
+}
+
+int skip_input( FILE *file, size_t count )
+{
+    uint8_t temp[256];
+    while( count > 0 )
+    {
+        size_t chunk = (count < sizeof( temp ))? count : sizeof( temp );
+        if( fread( temp, 1, chunk, file ) != chunk )
+        {
+            return -1;
+        }
+        count -= chunk;
+    }
+    return 0;
+}
+
+size_t texture_size( enum E_DEPTH depth, int32_t width, int32_t height )
+{
+    switch( depth )
+    {
+        case DEPTH_4BIT:
+            return (size_t)(width / 2) * height;
+        case DEPTH_8BIT:
+            return (size_t)width * height;
+        case DEPTH_16BIT:
+            return (size_t)width * height * 2;
+        default:
+            return (size_t)width * height * 4;
+    }
+}
+
+uint8_t *read_file( FILE *file, long *size )
+{
+    uint8_t *ret;
+    
+    if( fseek( file, 0, SEEK_END ) || (*size = ftell( file )) < 0 || fseek( file, 0, SEEK_SET ) )
+    {
+        return NULL;
+    }
+    ret = checked_malloc( *size + 1 );
+    if( fread( ret, 1, *size, file ) != (size_t)*size )
+    {
+        free( ret );
+        return NULL;
+    }
+    return ret;
+}
+
+int export_supported( enum E_FORMAT format, enum E_DEPTH depth )
+{
+    switch( format )
+    {
+        case FORMAT_RGBA:
+            return depth >= DEPTH_16BIT;
+        case FORMAT_CI:
+        case FORMAT_I:
+            return depth <= DEPTH_8BIT;
+        case FORMAT_IA:
+            return depth <= DEPTH_16BIT;
+        default:
+            return 0;
+    }
+}
+
+// Returns the job's palette from the cache, reading it first if needed.
+// For CI4 it comes back as a pair table for n64_export_ci4.
+const uint32_t *load_palette( FILE *romfile, const TEXJOB *job )
+{
+    PALETTE *palette;
+    uint8_t raw[256 * 4];
+    uint32_t pal[16];
+    int colors = (job->depth == DEPTH_4BIT)? 16 : 256;
+    size_t size = colors * ((job->pdepth == DEPTH_16BIT)? 2 : 4);
+    
+    for( size_t i = 0; i < palettes_used; i++ )
+    {
+        if( palettes[i].address == job->paddress && palettes[i].pdepth == job->pdepth && palettes[i].depth == job->depth )
+        {
+            return palettes[i].lut;
+        }
+    }
+    if( fseek( romfile, job->paddress, SEEK_SET ) || fread( raw, 1, size, romfile ) != size )
+    {
+        return NULL;
+    }
+    if( palettes_used < PALETTE_CACHE_SIZE )
+    {
+        palette = &palettes[palettes_used++];
+    }
+    else
+    {
+        palette = &palettes[palettes_next];
+        palettes_next = (palettes_next + 1) % PALETTE_CACHE_SIZE;
+    }
+    palette->address = job->paddress;
+    palette->pdepth = job->pdepth;
+    palette->depth = job->depth;
+    if( job->depth == DEPTH_4BIT )
+    {
+        n64_export( FORMAT_RGBA, job->pdepth, colors, raw, pal, NULL );
+        n64_expand_pal4( pal, palette->lut );
+    }
+    else
+    {
+        n64_export( FORMAT_RGBA, job->pdepth, colors, raw, palette->lut, NULL );
+    }
+    return palette->lut;
+}
+
+void export_row( const TEXJOB *job, size_t count, const uint8_t *in, uint32_t *out, const uint32_t *pal )
+{
+    if( job->format == FORMAT_CI && job->depth == DEPTH_4BIT )
+    {
+        n64_export_ci4( count, in, out, pal );
+    }
+    else
+    {
+        n64_export( job->format, job->depth, count, in, out, pal );
+    }
+}
+
+// Without a crop, the whole texture is exported. With one, the job's
+// width and height are the size of the rectangle.
+int export_texture( FILE *romfile, const TEXJOB *job, const CROP *crop, FILE *bmpfile, enum E_LAYOUT layout )
+{
+    BMPHEADER header = {0x4D42,0,0,0,0x36,0x28,0,0,1,32,0,0,0,0,0,0};
+    size_t size;
+    uint8_t *ibuf;
+    uint32_t *obuf;
+    uint32_t *rbuf = NULL;
+    const uint32_t *pbuf = NULL;
+    int32_t width = job->width;
+    int32_t height = job->height;
+    int32_t stride;
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t first;
+    int32_t last;
+    
+    n64_arena_reset( &scratch );
+    if( job->format == FORMAT_CI )
+    {
+        pbuf = load_palette( romfile, job );
+        if( pbuf == NULL )
+        {
+            fprintf( stderr, "Failed to read input file.\n" );
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if( crop == NULL )
+    {
+        if( job->depth == DEPTH_4BIT && (width & 1) > 0 ) width++;
+        stride = width;
+    }
+    else
+    {
+        stride = crop->stride;
+        x = crop->x;
+        y = crop->y;
+    }
+    // 4-bit rows are read from and to whole bytes
+    first = (job->depth == DEPTH_4BIT)? (x & ~1) : x;
+    last = (job->depth == DEPTH_4BIT)? ((x + width + 1) & ~1) : x + width;
+    size = texture_size( job->depth, last - first, 1 );
+    
+    header.width = width;
+    header.height = height;
+    header.imagesize = width * height * 4;
+    header.filesize = header.offset + header.imagesize;
+    
+    ibuf = scratch_alloc( size * height );
+    obuf = scratch_alloc( header.imagesize );
+    if( last - first != width )
+    {
+        rbuf = scratch_alloc( (last - first) * sizeof( uint32_t ) );
+    }
+    
+    if( first == 0 && last == stride )
+    {
+        // whole rows are contiguous, so read them all at once
+        if( fseek( romfile, job->address + texture_size( job->depth, stride, y ), SEEK_SET )
+            || fread( ibuf, 1, size * height, romfile ) != size * height )
+        {
+            fprintf( stderr, "Failed to read input file.\n" );
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        for( int32_t row = 0; row < height; row++ )
+        {
+            long offset = job->address + texture_size( job->depth, stride, y + row ) + texture_size( job->depth, first, 1 );
+            if( fseek( romfile, offset, SEEK_SET ) || fread( ibuf + (row * size), 1, size, romfile ) != size )
+            {
+                fprintf( stderr, "Failed to read input file.\n" );
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    
+    // BMP rows are decoded straight into bottom-up order so the image goes out in one write
+    for( int32_t row = 0; row < height; row++ )
+    {
+        uint32_t *out = obuf + (((layout == LAYOUT_BMP)? height - 1 - row : row) * width);
+        if( rbuf != NULL )
+        {
+            export_row( job, last - first, ibuf + (row * size), rbuf, pbuf );
+            memcpy( out, rbuf + (x - first), width * sizeof( uint32_t ) );
+        }
+        else
+        {
+            export_row( job, width, ibuf + (row * size), out, pbuf );
+        }
+    }
+    if( layout == LAYOUT_BMP )
+    {
+        if( fwrite( &header, sizeof( BMPHEADER ), 1, bmpfile ) != 1 )
+        {
+            fprintf( stderr, "Failed to write output file.\n" );
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        swizzle_pixels( layout, width * height, obuf );
+    }
+    if( fwrite( obuf, sizeof( uint32_t ), width * height, bmpfile ) != (size_t)(width * height) )
+    {
+        fprintf( stderr, "Failed to write output file.\n" );
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+// Writes a rectangle of pixels into a larger texture. Only the bytes
+// inside the rectangle are touched; for 4-bit, a byte shared with a pixel
+// outside it is read back so the other nibble is kept.
+int import_crop( FILE *romfile, const TEXJOB *job, const CROP *crop, const BMPIMAGE *image )
+{
+    int32_t first = (job->depth == DEPTH_4BIT)? (crop->x & ~1) : crop->x;
+    int32_t last = (job->depth == DEPTH_4BIT)? ((crop->x + job->width + 1) & ~1) : crop->x + job->width;
+    size_t size = texture_size( job->depth, last - first, 1 );
+    uint32_t *rbuf = scratch_alloc( (last - first) * sizeof( uint32_t ) );
+    uint32_t *row = scratch_alloc( job->width * sizeof( uint32_t ) );
+    uint8_t *obuf = scratch_alloc( size );
+    
+    for( int32_t y = 0; y < job->height; y++ )
+    {
+        long offset = job->address + texture_size( job->depth, crop->stride, crop->y + y ) + texture_size( job->depth, first, 1 );
+        const uint32_t *in = bmp_row( image, y, row );
+        uint8_t old;
+        
+        if( last - first != job->width )
+        {
+            rbuf[0] = rbuf[last - first - 1] = 0;
+            memcpy( rbuf + (crop->x - first), in, job->width * sizeof( uint32_t ) );
+            in = rbuf;
+        }
+        n64_import( job->format, job->depth, last - first, in, obuf );
+        if( crop->x != first )
+        {
+            if( fseek( romfile, offset, SEEK_SET ) || fread( &old, 1, 1, romfile ) != 1 )
+            {
+                fprintf( stderr, "Failed to read output file.\n" );
+                return EXIT_FAILURE;
+            }
+            obuf[0] = (old & 0xf0) | (obuf[0] & 0x0f);
+        }
+        if( crop->x + job->width != last )
+        {
+            if( fseek( romfile, offset + size - 1, SEEK_SET ) || fread( &old, 1, 1, romfile ) != 1 )
+            {
+                fprintf( stderr, "Failed to read output file.\n" );
+                return EXIT_FAILURE;
+            }
+            obuf[size - 1] = (obuf[size - 1] & 0xf0) | (old & 0x0f);
+        }
+        if( fseek( romfile, offset, SEEK_SET ) || fwrite( obuf, 1, size, romfile ) != size )
+        {
+            fprintf( stderr, "Failed to write output file.\n" );
+            return EXIT_FAILURE;
+        }
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+int export_jobs( FILE *romfile, const TEXJOB *jobs, size_t count, enum E_LAYOUT layout )
+{
+    int ret = EXIT_SUCCESS;
+    
+    for( size_t i = 0; i < count; i++ )
+    {
+        char name[48];
+        FILE *bmpfile;
+        
+        if( !export_supported( jobs[i].format, jobs[i].depth ) || jobs[i].address > UINT32_MAX
+            || jobs[i].width <= 0 || jobs[i].width > MAX_DIMENSION
+            || jobs[i].height <= 0 || jobs[i].height > MAX_DIMENSION )
+        {
+            fprintf( stderr, "Skipping unsupported texture at %08lX.\n", jobs[i].address );
+            continue;
+        }
+        // the same data can be used with different formats or sizes, so name each job after all of them
+        snprintf( name, sizeof( name ), "%08" PRIX32 "-%s%d-%" PRId32 "x%" PRId32 ".%s", (uint32_t)jobs[i].address,
+            format_names[jobs[i].format], 4 << jobs[i].depth, jobs[i].width, jobs[i].height,
+            (layout == LAYOUT_BMP)? "bmp" : "raw" );
+        printf( "%s\n", name );
+        bmpfile = fopen( name, "wb" );
+        if( bmpfile == NULL )
+        {
+            fprintf( stderr, "Could not open %s for writing.\n", name );
+            return EXIT_FAILURE;
+        }
+        if( export_texture( romfile, &jobs[i], NULL, bmpfile, layout ) != EXIT_SUCCESS )
+        {
+            ret = EXIT_FAILURE;
+        }
+        fclose( bmpfile );
+    }
+    return ret;
+}
+
+int hash_texture( FILE *romfile, const TEXJOB *job, uint64_t *hash )
+{
+    int32_t width = job->width + ((job->depth == DEPTH_4BIT)? (job->width & 1) : 0);
+    size_t size = texture_size( job->depth, width, job->height );
+    uint8_t *buf;
+    
+    n64_arena_reset( &scratch );
+    buf = scratch_alloc( size );
+    if( fseek( romfile, job->address, SEEK_SET ) || fread( buf, 1, size, romfile ) != size )
+    {
+        return -1;
+    }
+    *hash = hash_block( buf, size );
+    return 0;
+}
+
+// Adds the jobs to the ROM's index file, creating it if needed.
+int record_jobs( FILE *romfile, const char *indexname, const TEXJOB *jobs, size_t count )
+{
+    ROMINDEX index;
+    uint32_t crc[2];
+    
+    if( read_rom_crc( romfile, crc ) )
+    {
+        fprintf( stderr, "Failed to read input file.\n" );
+        return -1;
+    }
+    if( open_index( &index, indexname, crc, 1 ) )
+    {
+        return -1;
+    }
+    for( size_t i = 0; i < count; i++ )
+    {
+        uint64_t hash;
+        
+        if( hash_texture( romfile, &jobs[i], &hash ) || add_index_record( &index, &jobs[i], hash ) < 0 )
+        {
+            fprintf( stderr, "Could not index texture at %08lX.\n", jobs[i].address );
+        }
+    }
+    return close_index( &index );
+}
+
+// Matches one record by ID, or every record with the format and depth
+// (either can be -1 to match anything).
+int record_matches( const INDEXRECORD *record, uint32_t i, long id, int format, int depth )
+{
+    return (id < 0 || i == id) && (format < 0 || record->format == format) && (depth < 0 || record->depth == depth);
+}
+
+size_t select_records( const ROMINDEX *index, long id, int format, int depth, TEXJOB **jobs )
+{
+    size_t count = 0;
+    
+    *jobs = checked_malloc( (index->header.count + 1) * sizeof( TEXJOB ) );
+    for( uint32_t i = 0; i < index->header.count; i++ )
+    {
+        if( record_matches( &index->records[i], i, id, format, depth ) )
+        {
+            record_to_job( &index->records[i], &(*jobs)[count++] );
+        }
+    }
+    return count;
+}
+
 int main( int argc, char **argv )
 {
     char *romname = NULL;
     char *bmpname = NULL;
+    char *indexname = NULL;
     enum E_MODE mode = MODE_HELP;
+    enum E_LAYOUT layout = LAYOUT_BMP;
     enum E_FORMAT format = -1;
     enum E_DEPTH depth = -1;
     enum E_DEPTH pdepth = -1;
     long address = -1;
     long paddress = -1;
+    char *addresses = NULL;
+    long id = -1;
+    long dlist = -1;
+    long end = -1;
+    long step = 8;
+    int fanout = 0;
+    CROP crop = { 0, -1, -1 };
+    int32_t cropwidth = -1;
+    int32_t cropheight = -1;
     int32_t width = 0;
     int32_t height = 0;
     FILE *romfile = NULL;
     FILE *bmpfile = NULL;
+    long segments[SEGMENT_COUNT];
+    
+    for( int i = 0; i < SEGMENT_COUNT; i++ )
+    {
+        segments[i] = -1;
+    }
     
     while(1)
     {
@@ -67,6 +570,7 @@ int main( int argc, char **argv )
             { "help",     no_argument,       0, 'h' },
             { "romfile",  required_argument, 0, 'r' },
             { "bmpfile",  required_argument, 0, 'b' },
+            { "pixels",   required_argument, 0, 'p' },
             { "mode",     required_argument, 0, 'm' },
             { "format",   required_argument, 0, 'f' },
             { "depth",    required_argument, 0, 'd' },
@@ -75,9 +579,18 @@ int main( int argc, char **argv )
             { "height",   required_argument, 0, 'y' },
             { "pdepth",   required_argument, 0, 'e' },
             { "paddress", required_argument, 0, 'z' },
+            { "segment",  required_argument, 0, 's' },
+            { "dlist",    required_argument, 0, 'D' },
+            { "end",      required_argument, 0, 'E' },
+            { "step",     required_argument, 0, 't' },
+            { "fanout",   no_argument,       0, 'F' },
+            { "index",    required_argument, 0, 'I' },
+            { "id",       required_argument, 0, 'N' },
+            { "src-width", required_argument, 0, 'W' },
+            { "crop",     required_argument, 0, 'C' },
             { 0,         0,                 0, 0   }
         };
-        int opt = getopt_long( argc, argv, "hr:b:m:f:d:a:x:y:", longopts, NULL );
+        int opt = getopt_long( argc, argv, "hr:b:p:m:f:d:a:x:y:s:", longopts, NULL );
         if( opt == -1 )
         {
             break;
@@ -90,15 +603,41 @@ int main( int argc, char **argv )
             case 'b':
                 bmpname = optarg;
                 break;
+            case 'p':
+                if( strcasecmp( optarg, "BMP" ) == 0 )
+                {
+                    layout = LAYOUT_BMP;
+                }
+                else if( strcasecmp( optarg, "ARGB" ) == 0 )
+                {
+                    layout = LAYOUT_ARGB;
+                }
+                else if( strcasecmp( optarg, "RGBA" ) == 0 )
+                {
+                    layout = LAYOUT_RGBA;
+                }
+                break;
             case 'm':
                 if( strncasecmp( optarg, "e", 1 ) == 0 )
                 {
                     mode = MODE_EXPORT;
                 }
+                else if( strncasecmp( optarg, "d", 1 ) == 0 )
+                {
+                    mode = MODE_DEDUP;
+                }
                 else if( strncasecmp( optarg, "i", 1 ) == 0 )
                 {
                     mode = MODE_IMPORT;
                 }
+                else if( strncasecmp( optarg, "l", 1 ) == 0 )
+                {
+                    mode = MODE_LIST;
+                }
+                else if( strncasecmp( optarg, "w", 1 ) == 0 )
+                {
+                    mode = MODE_WALK;
+                }
                 break;
             case 'f':
                 if( strcasecmp( optarg, "RGBA" ) == 0 )
@@ -158,10 +697,57 @@ int main( int argc, char **argv )
             }
             case 'a':
                 address = strtol( optarg, NULL, 0 );
+                addresses = optarg;
                 break;
             case 'z':
                 paddress = strtol( optarg, NULL, 0 );
                 break;
+            case 's':
+            {
+                char *end;
+                long temp = strtol( optarg, &end, 0 );
+                if( temp < 0 || temp >= SEGMENT_COUNT || *end != '=' )
+                {
+                    print_help( argv[0] );
+                }
+                segments[temp] = strtol( end + 1, NULL, 0 );
+                break;
+            }
+            case 'D':
+                dlist = strtol( optarg, NULL, 0 );
+                break;
+            case 'E':
+                end = strtol( optarg, NULL, 0 );
+                break;
+            case 't':
+                step = strtol( optarg, NULL, 0 );
+                break;
+            case 'F':
+                fanout = 1;
+                break;
+            case 'I':
+                indexname = optarg;
+                break;
+            case 'N':
+                id = strtol( optarg, NULL, 0 );
+                break;
+            case 'W':
+                crop.stride = strtol( optarg, NULL, 0 );
+                break;
+            case 'C':
+            {
+                // x,y for import, x,y,w,h for export
+                char *end;
+                crop.x = strtol( optarg, &end, 0 );
+                if( *end == ',' ) crop.y = strtol( end + 1, &end, 0 );
+                if( *end == ',' ) cropwidth = strtol( end + 1, &end, 0 );
+                if( *end == ',' ) cropheight = strtol( end + 1, &end, 0 );
+                if( *end != 0 )
+                {
+                    print_help( argv[0] );
+                }
+                break;
+            }
             case 'x':
                 width = strtol( optarg, NULL, 0 );
                 break;
@@ -178,65 +764,129 @@ int main( int argc, char **argv )
     {
         case MODE_EXPORT:
         {
-            BMPHEADER header = {0x4D42,0,0,0,0x36,0x28,0,0,1,32,0,0,0,0,0,0};
-            size_t size;
-            uint8_t *ibuf;
-            uint32_t *obuf;
-            uint32_t *pbuf = NULL;
+            TEXJOB job;
+            int ret;
+            
+            if( crop.stride > 0 || crop.x >= 0 )
+            {
+                if( crop.stride <= 0 || crop.x < 0 || crop.y < 0 || cropwidth <= 0 || cropheight <= 0
+                    || crop.stride > MAX_DIMENSION || crop.x > MAX_DIMENSION || cropwidth > MAX_DIMENSION
+                    || crop.y > MAX_DIMENSION || cropheight > MAX_DIMENSION || crop.y + cropheight > MAX_DIMENSION
+                    || crop.x + cropwidth > crop.stride || (depth == DEPTH_4BIT && (crop.stride & 1) > 0)
+                    || indexname != NULL )
+                {
+                    fprintf( stderr, "Invalid arguments for export.\n" );
+                    return EXIT_FAILURE;
+                }
+                width = cropwidth;
+                height = cropheight;
+            }
+            job = (TEXJOB){ format, depth, pdepth, address, paddress, width, height };
             
-            if( romname == NULL || format < 0 || depth < 0 || address < 0 || width <= 0 || height <= 0 )
+            // without an address, the index says what to export
+            if( indexname != NULL && (id >= 0 || address < 0) )
+            {
+                ROMINDEX index;
+                TEXJOB *jobs;
+                uint32_t crc[2];
+                size_t count;
+                
+                if( romname == NULL )
+                {
+                    fprintf( stderr, "Invalid arguments for export.\n" );
+                    return EXIT_FAILURE;
+                }
+                romfile = fopen( romname, "rb" );
+                if( romfile == NULL )
+                {
+                    fprintf( stderr, "Could not open %s for reading.\n", romname );
+                    return EXIT_FAILURE;
+                }
+                if( read_rom_crc( romfile, crc ) )
+                {
+                    fprintf( stderr, "Failed to read input file.\n" );
+                    return EXIT_FAILURE;
+                }
+                if( open_index( &index, indexname, crc, 0 ) )
+                {
+                    return EXIT_FAILURE;
+                }
+                count = select_records( &index, id, format, depth, &jobs );
+                close_index( &index );
+                if( count == 0 )
+                {
+                    fprintf( stderr, "No matching index entries.\n" );
+                    return EXIT_FAILURE;
+                }
+                ret = export_jobs( romfile, jobs, count, layout );
+                free( jobs );
+                fclose( romfile );
+                
+                return ret;
+            }
+            if( romname == NULL || format < 0 || depth < 0 || address < 0
+                || width <= 0 || width > MAX_DIMENSION || height <= 0 || height > MAX_DIMENSION )
             {
                 fprintf( stderr, "Invalid arguments for export.\n" );
                 return EXIT_FAILURE;
             }
-            switch( format )
+            if( !export_supported( format, depth ) )
             {
-                case FORMAT_RGBA:
+                fprintf( stderr, "Unsupported format.\n" );
+                return EXIT_FAILURE;
+            }
+            if( format == FORMAT_CI && (pdepth < 0 || paddress < 0) )
+            {
+                fprintf( stderr, "Invalid arguments for export.\n" );
+                return EXIT_FAILURE;
+            }
+            // a list of addresses shares everything else, including the palette
+            if( strchr( addresses, ',' ) != NULL )
+            {
+                TEXJOB *jobs;
+                size_t count = 0;
+                size_t commas = 0;
+                char *start = addresses;
+                char *end;
+                
+                if( bmpname != NULL || crop.stride > 0 || crop.x >= 0 || indexname != NULL )
                 {
-                    if( depth < DEPTH_16BIT )
-                    {
-                        fprintf( stderr, "Unsupported format.\n" );
-                        return EXIT_FAILURE;
-                    }
-                    break;
+                    fprintf( stderr, "Invalid arguments for export.\n" );
+                    return EXIT_FAILURE;
                 }
-                case FORMAT_CI:
+                for( char *c = addresses; *c != 0; c++ )
                 {
-                    if( pdepth < 0 || paddress < 0 )
-                    {
-                        fprintf( stderr, "Invalid arguments for export.\n" );
-                        return EXIT_FAILURE;
-                    }
-                    if( depth > DEPTH_8BIT )
-                    {
-                        fprintf( stderr, "Unsupported format.\n" );
-                        return EXIT_FAILURE;
-                    }
-                    break;
+                    commas += (*c == ',');
                 }
-                case FORMAT_IA:
+                jobs = checked_malloc( (commas + 1) * sizeof( TEXJOB ) );
+                while( 1 )
                 {
-                    if( depth > DEPTH_16BIT )
+                    jobs[count] = job;
+                    jobs[count].address = strtol( start, &end, 0 );
+                    if( end == start || (*end != ',' && *end != 0) || jobs[count].address < 0 )
                     {
-                        fprintf( stderr, "Unsupported format.\n" );
+                        free( jobs );
+                        fprintf( stderr, "Invalid arguments for export.\n" );
                         return EXIT_FAILURE;
                     }
-                    break;
-                }
-                case FORMAT_I:
-                {
-                    if( depth > DEPTH_8BIT )
+                    count++;
+                    if( *end == 0 )
                     {
-                        fprintf( stderr, "Unsupported format.\n" );
-                        return EXIT_FAILURE;
+                        break;
                     }
-                    break;
+                    start = end + 1;
                 }
-                default:
+                romfile = fopen( romname, "rb" );
+                if( romfile == NULL )
                 {
-                    fprintf( stderr, "Unsupported format.\n" );
+                    fprintf( stderr, "Could not open %s for reading.\n", romname );
                     return EXIT_FAILURE;
                 }
+                ret = export_jobs( romfile, jobs, count, layout );
+                free( jobs );
+                fclose( romfile );
+                
+                return ret;
             }
             romfile = fopen( romname, "rb" );
             if( romfile == NULL )
@@ -252,7 +902,7 @@ int main( int argc, char **argv )
                     return EXIT_FAILURE;
                 }
                 bmpname = checked_malloc( 13 );
-                sprintf( bmpname, "%08" PRIX32 ".bmp", (uint32_t)address );
+                sprintf( bmpname, "%08" PRIX32 ".%s", (uint32_t)address, (layout == LAYOUT_BMP)? "bmp" : "raw" );
                 bmpfile = fopen( bmpname, "wb" );
                 if( bmpfile == NULL )
                 {
@@ -261,6 +911,10 @@ int main( int argc, char **argv )
                 }
                 free( bmpname );
             }
+            else if( strcmp( bmpname, "-" ) == 0 )
+            {
+                bmpfile = binary_stdio( stdout );
+            }
             else
             {
                 bmpfile = fopen( bmpname, "wb" );
@@ -271,82 +925,201 @@ int main( int argc, char **argv )
                 }
             }
             
-            if( format == FORMAT_CI )
+            ret = export_texture( romfile, &job, (crop.stride > 0)? &crop : NULL, bmpfile, layout );
+            if( ret == EXIT_SUCCESS && indexname != NULL && record_jobs( romfile, indexname, &job, 1 ) )
+            {
+                ret = EXIT_FAILURE;
+            }
+            fclose( romfile );
+            fclose( bmpfile );
+            
+            return ret;
+        }
+        case MODE_WALK:
+        {
+            TEXJOB *jobs;
+            size_t count;
+            int ret;
+            
+            if( romname == NULL || address < 0 )
+            {
+                fprintf( stderr, "Invalid arguments for walk.\n" );
+                return EXIT_FAILURE;
+            }
+            romfile = fopen( romname, "rb" );
+            if( romfile == NULL )
+            {
+                fprintf( stderr, "Could not open %s for reading.\n", romname );
+                return EXIT_FAILURE;
+            }
+            
+            count = walk_dlist( romfile, address, segments, &jobs );
+            if( indexname != NULL && record_jobs( romfile, indexname, jobs, count ) )
             {
-                if( fseek( romfile, paddress, SEEK_SET ) )
+                return EXIT_FAILURE;
+            }
+            ret = export_jobs( romfile, jobs, count, layout );
+            free( jobs );
+            fclose( romfile );
+            
+            return ret;
+        }
+        case MODE_LIST:
+        {
+            ROMINDEX index;
+            uint32_t crc[2];
+            
+            if( indexname == NULL )
+            {
+                fprintf( stderr, "Invalid arguments for list.\n" );
+                return EXIT_FAILURE;
+            }
+            // the ROM is optional and only used to check that the index belongs to it
+            if( romname != NULL )
+            {
+                romfile = fopen( romname, "rb" );
+                if( romfile == NULL )
                 {
-                    fprintf( stderr, "Failed to read input file.\n" );
+                    fprintf( stderr, "Could not open %s for reading.\n", romname );
                     return EXIT_FAILURE;
                 }
-                int colors = (depth == DEPTH_4BIT)? 16 : 256;
-                size = colors * ((pdepth == DEPTH_16BIT)? 2 : 4);
-                ibuf = checked_malloc( size );
-                pbuf = checked_malloc( colors * sizeof( uint32_t ) );
-                if( fread( ibuf, 1, size, romfile ) != size )
+                if( read_rom_crc( romfile, crc ) )
                 {
                     fprintf( stderr, "Failed to read input file.\n" );
                     return EXIT_FAILURE;
                 }
-                n64_export( FORMAT_RGBA, pdepth, colors, ibuf, pbuf, NULL );
-                free( ibuf );
+                fclose( romfile );
             }
-            
-            if( fseek( romfile, address, SEEK_SET ) )
+            if( open_index( &index, indexname, (romname != NULL)? crc : NULL, 0 ) )
             {
-                fprintf( stderr, "Failed to read input file.\n" );
                 return EXIT_FAILURE;
             }
-            
-            if( depth == DEPTH_4BIT && (width & 1) > 0 ) width++;
-            
-            header.width = width;
-            header.height = height;
-            header.imagesize = width * height * 4;
-            header.filesize = header.offset + header.imagesize;
-            
-            switch( depth )
+            printf( "CRC %08" PRIX32 " %08" PRIX32 ", %" PRIu32 " entries\n",
+                index.header.crc1, index.header.crc2, index.header.count );
+            for( uint32_t i = 0; i < index.header.count; i++ )
             {
-                case DEPTH_4BIT:
-                    size = (width / 2) * height;
-                    break;
-                case DEPTH_8BIT:
-                    size = width * height;
-                    break;
-                case DEPTH_16BIT:
-                    size = width * height * 2;
-                    break;
-                default:
-                    size = width * height * 4;
-                    break;
+                const INDEXRECORD *record = &index.records[i];
+                if( !record_matches( record, i, id, format, depth ) )
+                {
+                    continue;
+                }
+                printf( "%6" PRIu32 "  %08" PRIX32 "  %-4s %2d  %4" PRIu16 "x%-4" PRIu16 "  ", i, record->address,
+                    (record->format < 5)? format_names[record->format] : "?", 4 << record->depth, record->width, record->height );
+                if( record->format == FORMAT_CI )
+                {
+                    printf( "pal %08" PRIX32 "/%-2d  ", record->paddress, 4 << record->pdepth );
+                }
+                else
+                {
+                    printf( "%-17s", "" );
+                }
+                printf( "%016" PRIX64 "\n", record->hash );
             }
+            close_index( &index );
             
-            ibuf = checked_malloc( size );
-            obuf = checked_malloc( header.imagesize );
+            return EXIT_SUCCESS;
+        }
+        case MODE_DEDUP:
+        {
+            uint8_t *rom;
+            long romsize;
+            REGION *regions;
+            size_t count;
+            size_t groups = 0;
             
-            if( fread( ibuf, 1, size, romfile ) != size )
+            if( romname == NULL || step <= 0 || (dlist < 0 && (depth < 0 || width <= 0 || height <= 0)) )
+            {
+                fprintf( stderr, "Invalid arguments for dedup.\n" );
+                return EXIT_FAILURE;
+            }
+            romfile = fopen( romname, "rb" );
+            if( romfile == NULL )
+            {
+                fprintf( stderr, "Could not open %s for reading.\n", romname );
+                return EXIT_FAILURE;
+            }
+            rom = read_file( romfile, &romsize );
+            if( rom == NULL )
             {
                 fprintf( stderr, "Failed to read input file.\n" );
                 return EXIT_FAILURE;
             }
-            n64_export( format, depth, width * height, ibuf, obuf, pbuf );
-            fwrite( &header, sizeof( BMPHEADER ), 1, bmpfile );
-            for( int32_t y = height - 1; y >= 0; y-- )
+            
+            if( dlist >= 0 )
+            {
+                TEXJOB *jobs;
+                count = walk_dlist( romfile, dlist, segments, &jobs );
+                regions = checked_malloc( (count + 1) * sizeof( REGION ) );
+                for( size_t i = 0; i < count; i++ )
+                {
+                    int32_t w = jobs[i].width + ((jobs[i].depth == DEPTH_4BIT)? (jobs[i].width & 1) : 0);
+                    regions[i].address = jobs[i].address;
+                    regions[i].size = texture_size( jobs[i].depth, w, jobs[i].height );
+                }
+                free( jobs );
+                count = hash_region_list( rom, romsize, regions, count );
+            }
+            else
             {
-                fwrite( obuf + (y * width), sizeof( uint32_t ), width, bmpfile );
+                if( depth == DEPTH_4BIT && (width & 1) > 0 ) width++;
+                if( address < 0 ) address = 0;
+                if( end < 0 || end > romsize ) end = romsize;
+                count = hash_regions( rom, address, end, step, texture_size( depth, width, height ), &regions );
             }
             fclose( romfile );
-            fclose( bmpfile );
+            
+            sort_regions( regions, count );
+            for( size_t i = 0; i < count; )
+            {
+                size_t run = i + 1;
+                while( run < count && regions[run].size == regions[i].size && regions[run].hash == regions[i].hash )
+                {
+                    run++;
+                }
+                // a matching hash is only a candidate until the bytes are compared
+                for( size_t a = i; a < run; a++ )
+                {
+                    size_t members = 1;
+                    
+                    if( regions[a].address < 0 )
+                    {
+                        continue;
+                    }
+                    for( size_t b = a + 1; b < run; b++ )
+                    {
+                        if( regions[b].address >= 0 && same_region( rom, &regions[a], &regions[b] ) )
+                        {
+                            if( members++ == 1 )
+                            {
+                                printf( "%ld bytes: %08lX", regions[a].size, regions[a].address );
+                            }
+                            printf( " %08lX", regions[b].address );
+                            regions[b].address = -1;
+                        }
+                    }
+                    if( members > 1 )
+                    {
+                        printf( "\n" );
+                        groups++;
+                    }
+                }
+                i = run;
+            }
+            fprintf( stderr, "%zu groups of identical textures.\n", groups );
+            free( regions );
+            free( rom );
             
             return EXIT_SUCCESS;
         }
         case MODE_IMPORT:
         {
-            BMPHEADER header;
+            BMPIMAGE image;
             size_t size;
-            uint32_t *ibuf;
+            uint32_t *row;
             uint8_t *obuf;
             
-            if( romname == NULL || format < 0 || depth < 0 || address < 0 )
+            if( romname == NULL || format < 0 || depth < 0 || address < 0
+                || (layout != LAYOUT_BMP && (width <= 0 || width > MAX_DIMENSION || height <= 0 || height > MAX_DIMENSION)) )
             {
                 fprintf( stderr, "Invalid arguments for import.\n" );
                 return EXIT_FAILURE;
@@ -400,7 +1173,7 @@ int main( int argc, char **argv )
                     return EXIT_FAILURE;
                 }
                 bmpname = checked_malloc( 13 );
-                sprintf( bmpname, "%08" PRIX32 ".bmp", (uint32_t)address );
+                sprintf( bmpname, "%08" PRIX32 ".%s", (uint32_t)address, (layout == LAYOUT_BMP)? "bmp" : "raw" );
                 bmpfile = fopen( bmpname, "rb" );
                 if( bmpfile == NULL )
                 {
@@ -409,6 +1182,10 @@ int main( int argc, char **argv )
                 }
                 free( bmpname );
             }
+            else if( strcmp( bmpname, "-" ) == 0 )
+            {
+                bmpfile = binary_stdio( stdin );
+            }
             else
             {
                 bmpfile = fopen( bmpname, "rb" );
@@ -419,23 +1196,17 @@ int main( int argc, char **argv )
                 }
             }
             
-            if( fread( &header, sizeof( BMPHEADER ), 1, bmpfile ) != 1 )
+            if( layout == LAYOUT_BMP )
             {
-                fprintf( stderr, "Input file invalid.\n" );
-                return EXIT_FAILURE;
-            }
-            if( header.magic != 0x4d42 || header.headersize < 0x28
-                || header.width < 1 || header.height < 1
-                || header.planes != 1 || header.bpp != 32
-                || header.compression != 0 )
-            {
-                fprintf( stderr, "Input file unsupported or invalid.\n" );
-                return EXIT_FAILURE;
+                if( read_bmp( bmpfile, &image ) )
+                {
+                    return EXIT_FAILURE;
+                }
+                width = image.width;
+                height = image.height;
             }
-            
-            if( fseek( bmpfile, header.offset, SEEK_SET ) )
+            else if( read_pixels( bmpfile, layout, width, height, &image ) )
             {
-                fprintf( stderr, "Failed to read input file.\n" );
                 return EXIT_FAILURE;
             }
             if( fseek( romfile, address, SEEK_SET ) )
@@ -444,44 +1215,78 @@ int main( int argc, char **argv )
                 return EXIT_FAILURE;
             }
             
-            width = header.width;
-            height = header.height;
-            
-            if( depth == DEPTH_4BIT && (width & 1) > 0 )
+            if( crop.stride > 0 || crop.x >= 0 )
+            {
+                if( crop.stride <= 0 || crop.x < 0 || crop.y < 0
+                    || crop.stride > MAX_DIMENSION || crop.x > MAX_DIMENSION
+                    || crop.y > MAX_DIMENSION || crop.y + height > MAX_DIMENSION || crop.x + width > crop.stride
+                    || (cropwidth >= 0 && cropwidth != width) || (cropheight >= 0 && cropheight != height)
+                    || (depth == DEPTH_4BIT && (crop.stride & 1) > 0) || fanout )
+                {
+                    fprintf( stderr, "Invalid arguments for import.\n" );
+                    return EXIT_FAILURE;
+                }
+            }
+            else if( depth == DEPTH_4BIT && (width & 1) > 0 )
             {
                 fprintf( stderr, "Width must be divisible by 2 for 4-bit.\n" );
                 return EXIT_FAILURE;
             }
             
-            switch( depth )
+            size = texture_size( depth, width, height );
+            
+            if( crop.stride > 0 )
             {
-                case DEPTH_4BIT:
-                    size = (width / 2) * height;
-                    break;
-                case DEPTH_8BIT:
-                    size = width * height;
-                    break;
-                case DEPTH_16BIT:
-                    size = width * height * 2;
-                    break;
-                default:
-                    size = width * height * 4;
-                    break;
+                TEXJOB job = { format, depth, -1, address, -1, width, height };
+                int ret = import_crop( romfile, &job, &crop, &image );
+                fclose( romfile );
+                fclose( bmpfile );
+                
+                return ret;
             }
-            
-            ibuf = checked_malloc( width * height * 4 );
-            obuf = checked_malloc( size );
-            
-            for( int32_t y = height - 1; y >= 0; y-- )
+            obuf = scratch_alloc( size );
+            row = scratch_alloc( width * sizeof( uint32_t ) );
+            // rows come out of the image top first whatever order the file uses
+            for( int32_t y = 0; y < height; y++ )
             {
-                if( fread( ibuf + (y * width), sizeof( uint32_t ), width, bmpfile ) != width )
+                n64_import( format, depth, width, bmp_row( &image, y, row ), obuf + texture_size( depth, width, y ) );
+            }
+            if( fanout )
+            {
+                uint8_t *rom;
+                long romsize;
+                long *copies;
+                size_t count;
+                
+                rom = read_file( romfile, &romsize );
+                if( rom == NULL )
                 {
-                    fprintf( stderr, "Error reading bitmap file.\n" );
+                    fprintf( stderr, "Failed to read output file.\n" );
                     return EXIT_FAILURE;
                 }
+                // copies are found from the old data, so all of them are located before any are overwritten
+                count = find_copies( rom, romsize, address, size, step, &copies );
+                for( size_t i = 0; i < count; i++ )
+                {
+                    if( fseek( romfile, copies[i], SEEK_SET ) || fwrite( obuf, 1, size, romfile ) != size )
+                    {
+                        fprintf( stderr, "Failed to write output file.\n" );
+                        return EXIT_FAILURE;
+                    }
+                }
+                if( count == 0 )
+                {
+                    fprintf( stderr, "Texture does not fit in the output file.\n" );
+                    return EXIT_FAILURE;
+                }
+                fprintf( stderr, "Wrote texture to %zu addresses.\n", count );
+                free( copies );
+                free( rom );
+            }
+            else
+            {
+                fwrite( obuf, 1, size, romfile );
             }
-            n64_import( format, depth, width * height, ibuf, obuf );
-            fwrite( obuf, 1, size, romfile );
             fclose( romfile );
             fclose( bmpfile );
             
@@ -4,9 +4,17 @@
  * To Public License, Version 2, as published by Sam Hocevar. See
  * the COPYING file for more details. */
 
+#ifndef CLI_H
+#define CLI_H
+
 #include <stdint.h>
+#include <stdio.h>
+#include "n64rawgfx.h"
+
+#define MAX_DIMENSION 16384    // keeps width * height * 4 within a BMP's 32-bit size
 
-enum E_MODE { MODE_HELP, MODE_EXPORT, MODE_IMPORT };
+enum E_MODE { MODE_HELP, MODE_EXPORT, MODE_IMPORT, MODE_WALK, MODE_DEDUP, MODE_LIST };
+enum E_LAYOUT { LAYOUT_BMP, LAYOUT_ARGB, LAYOUT_RGBA };
 
 #pragma pack(push, 1)
 typedef struct {            // byte packing is mandatory
@@ -28,3 +36,38 @@ typedef struct {            // byte packing is mandatory
     uint32_t clr_important;
 } BMPHEADER;
 #pragma pack(pop)
+
+typedef struct {
+    enum E_FORMAT format;
+    enum E_DEPTH depth;
+    enum E_DEPTH pdepth;    // CI only
+    long address;
+    long paddress;          // CI only
+    int32_t width;
+    int32_t height;
+} TEXJOB;
+
+#define PALETTE_CACHE_SIZE 16
+
+typedef struct {
+    long address;
+    enum E_DEPTH pdepth;
+    enum E_DEPTH depth;     // of the texture: CI4 or CI8
+    uint32_t lut[512];      // CI8 colors, or CI4 pairs from n64_expand_pal4
+} PALETTE;
+
+typedef struct {
+    int32_t stride;         // width of the whole texture
+    int32_t x;
+    int32_t y;
+} CROP;
+
+extern const char *const format_names[];
+extern N64_ARENA scratch;
+
+void *checked_malloc( size_t size );
+void *checked_realloc( void *ptr, size_t size );
+void *scratch_alloc( size_t size );
+int skip_input( FILE *file, size_t count );
+
+#endif
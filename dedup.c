@@ -0,0 +1,195 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+#include <string.h>
+#include "cli.h"
+#include "dedup.h"
+
+#define HASH_BASE 0x100000001B3ull
+
+typedef struct {
+    const uint8_t *rom;
+    long size;
+    uint64_t hash;
+    long *copies;
+    size_t count;
+    long next;              // first address that doesn't overlap the last copy
+} COPIES;
+
+// Calls visit() for every step-aligned region of the given size inside
+// [start, end) that isn't a single repeated byte.
+static void roll_hashes( const uint8_t *rom, long start, long end, long step, long size,
+    void (*visit)( void *ctx, long address, uint64_t hash ), void *ctx )
+{
+    uint64_t hash = 0;
+    uint64_t top = 1;
+    long change = start;    // last byte in the window that differs from the one before it
+    long phase = 0;
+    
+    if( size <= 0 || step <= 0 || end - start < size )
+    {
+        return;
+    }
+    for( long i = 1; i < size; i++ )
+    {
+        top *= HASH_BASE;
+    }
+    for( long i = start; i < start + size; i++ )
+    {
+        hash = hash * HASH_BASE + rom[i];
+        if( i > start && rom[i] != rom[i - 1] )
+        {
+            change = i;
+        }
+    }
+    for( long p = start; ; p++ )
+    {
+        if( phase == 0 && change > p )
+        {
+            visit( ctx, p, hash );
+        }
+        if( ++phase == step )
+        {
+            phase = 0;
+        }
+        if( p + size >= end )
+        {
+            break;
+        }
+        hash = (hash - rom[p] * top) * HASH_BASE + rom[p + size];
+        if( rom[p + size] != rom[p + size - 1] )
+        {
+            change = p + size;
+        }
+    }
+}
+
+static void visit_region( void *ctx, long address, uint64_t hash )
+{
+    REGION **next = ctx;
+    (*next)->hash = hash;
+    (*next)->address = address;
+    (*next)++;
+}
+
+static void visit_copy( void *ctx, long address, uint64_t hash )
+{
+    COPIES *copies = ctx;
+    long original = copies->copies[0];
+    if( address != original && address < original + copies->size && address + copies->size > original )
+    {
+        return;
+    }
+    if( hash != copies->hash || address < copies->next
+        || memcmp( copies->rom + address, copies->rom + original, copies->size ) != 0 )
+    {
+        return;
+    }
+    if( address != original )
+    {
+        copies->copies[copies->count++] = address;
+    }
+    copies->next = address + copies->size;
+}
+
+static int compare_regions( const void *a, const void *b )
+{
+    const REGION *ra = a;
+    const REGION *rb = b;
+    if( ra->size != rb->size )
+    {
+        return (ra->size < rb->size)? -1 : 1;
+    }
+    if( ra->hash != rb->hash )
+    {
+        return (ra->hash < rb->hash)? -1 : 1;
+    }
+    if( ra->address != rb->address )
+    {
+        return (ra->address < rb->address)? -1 : 1;
+    }
+    return 0;
+}
+
+uint64_t hash_block( const uint8_t *data, size_t size )
+{
+    uint64_t hash = 0;
+    for( size_t i = 0; i < size; i++ )
+    {
+        hash = hash * HASH_BASE + data[i];
+    }
+    return hash;
+}
+
+size_t hash_regions( const uint8_t *rom, long start, long end, long step, long size, REGION **regions )
+{
+    REGION *next;
+    
+    if( size <= 0 || step <= 0 || end - start < size )
+    {
+        *regions = NULL;
+        return 0;
+    }
+    *regions = checked_malloc( ((end - start - size) / step + 1) * sizeof( REGION ) );
+    next = *regions;
+    roll_hashes( rom, start, end, step, size, visit_region, &next );
+    for( REGION *r = *regions; r < next; r++ )
+    {
+        r->size = size;
+    }
+    return next - *regions;
+}
+
+size_t hash_region_list( const uint8_t *rom, long romsize, REGION *regions, size_t count )
+{
+    size_t kept = 0;
+    for( size_t i = 0; i < count; i++ )
+    {
+        long size = regions[i].size;
+        
+        if( regions[i].address < 0 || size <= 0 || regions[i].address > romsize - size )
+        {
+            continue;
+        }
+        const uint8_t *data = rom + regions[i].address;
+        if( memcmp( data, data + 1, size - 1 ) == 0 )
+        {
+            continue;
+        }
+        regions[kept] = regions[i];
+        regions[kept].hash = hash_block( data, size );
+        kept++;
+    }
+    return kept;
+}
+
+void sort_regions( REGION *regions, size_t count )
+{
+    qsort( regions, count, sizeof( REGION ), compare_regions );
+}
+
+int same_region( const uint8_t *rom, const REGION *a, const REGION *b )
+{
+    return a->size == b->size && a->hash == b->hash
+        && memcmp( rom + a->address, rom + b->address, a->size ) == 0;
+}
+
+size_t find_copies( const uint8_t *rom, long romsize, long address, long size, long step, long **copies )
+{
+    COPIES ctx = { rom, size, 0, NULL, 1, 0 };
+    
+    if( address < 0 || size <= 0 || step <= 0 || address > romsize - size )
+    {
+        *copies = NULL;
+        return 0;
+    }
+    ctx.hash = hash_block( rom + address, size );
+    ctx.copies = checked_malloc( (romsize / size + 1) * sizeof( long ) );
+    ctx.copies[0] = address;
+    roll_hashes( rom, address % step, romsize, step, size, visit_copy, &ctx );
+    *copies = ctx.copies;
+    return ctx.count;
+}
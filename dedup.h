@@ -0,0 +1,36 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+/* Finds identical texture data in a ROM image held in memory. Regions
+ * are hashed with a polynomial rolling hash, so scanning every aligned
+ * offset costs one multiply per byte no matter how large the texture
+ * is. Equal hashes are always confirmed with memcmp. Regions that are
+ * one repeated byte (usually padding) are never reported.
+ *
+ * find_copies() returns the non-overlapping copies of one region, with
+ * the region itself always first.
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    uint64_t hash;
+    long address;
+    long size;
+} REGION;
+
+uint64_t hash_block( const uint8_t *data, size_t size );
+size_t hash_regions( const uint8_t *rom, long start, long end, long step, long size, REGION **regions );
+size_t hash_region_list( const uint8_t *rom, long romsize, REGION *regions, size_t count );
+void sort_regions( REGION *regions, size_t count );
+int same_region( const uint8_t *rom, const REGION *a, const REGION *b );
+size_t find_copies( const uint8_t *rom, long romsize, long address, long size, long step, long **copies );
+
+#endif
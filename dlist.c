@@ -0,0 +1,259 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+#include <inttypes.h>
+#include <string.h>
+#include "dlist.h"
+
+#define G_DL            0x06
+#define G_ENDDL         0xB8
+#define G_LOADTLUT      0xF0
+#define G_SETTILESIZE   0xF2
+#define G_LOADBLOCK     0xF3
+#define G_LOADTILE      0xF4
+#define G_SETTILE       0xF5
+#define G_SETTIMG       0xFD
+
+#define DL_STACK_SIZE   18          // F3DEX allows 18, F3D only 10
+#define DL_MAX_COMMANDS 0x100000    // give up on lists that never end
+#define TMEM_WORDS      512         // 4KB of 64-bit words
+#define TLUT_BASE       256         // palettes live in the upper half
+
+typedef struct {
+    enum E_FORMAT format;
+    enum E_DEPTH depth;
+    uint32_t line;          // row length in 64-bit words
+    uint32_t tmem;
+    uint32_t palette;
+} TILE;
+
+typedef struct {
+    long address;           // ROM address of the first loaded texel, -1 if empty
+    long size;              // bytes loaded (LOADBLOCK)
+    int32_t stride;         // source row length in bytes, 0 for LOADBLOCK
+    int32_t rows;           // rows loaded (LOADTILE)
+} LOAD;
+
+static int bits_per_texel( enum E_DEPTH depth )
+{
+    return 4 << depth;
+}
+
+static long segmented_to_rom( uint32_t address, const long *segments )
+{
+    int segment = (address >> 24) & 0x0f;
+    if( segments[segment] < 0 )
+    {
+        fprintf( stderr, "Segment %d is not mapped (address %08" PRIX32 ").\n", segment, address );
+        return -1;
+    }
+    return segments[segment] + (address & 0x00ffffff);
+}
+
+static size_t add_job( TEXJOB **jobs, size_t count, const TEXJOB *job )
+{
+    for( size_t i = 0; i < count; i++ )
+    {
+        const TEXJOB *old = &(*jobs)[i];
+        if( old->address == job->address && old->format == job->format && old->depth == job->depth
+            && old->width == job->width && old->height == job->height
+            && old->paddress == job->paddress && old->pdepth == job->pdepth )
+        {
+            return count;
+        }
+    }
+    // grow by doubling; counts that are a power of two are full
+    if( (count & (count - 1)) == 0 )
+    {
+        *jobs = checked_realloc( *jobs, (count? count * 2 : 16) * sizeof( TEXJOB ) );
+    }
+    (*jobs)[count] = *job;
+    return count + 1;
+}
+
+size_t walk_dlist( FILE *romfile, long address, const long *segments, TEXJOB **jobs )
+{
+    long stack[DL_STACK_SIZE];
+    int sp = 0;
+    TILE tiles[8];
+    LOAD tmem[TMEM_WORDS];
+    long tlut[16];
+    long timg = -1;
+    enum E_DEPTH timg_depth = DEPTH_16BIT;
+    uint32_t timg_width = 0;
+    int load_tile = -1;
+    size_t count = 0;
+    
+    memset( tiles, 0, sizeof( tiles ) );
+    for( int i = 0; i < TMEM_WORDS; i++ )
+    {
+        tmem[i].address = -1;
+    }
+    for( int i = 0; i < 16; i++ )
+    {
+        tlut[i] = -1;
+    }
+    *jobs = NULL;
+    
+    for( long n = 0; n < DL_MAX_COMMANDS; n++ )
+    {
+        uint8_t cmd[8];
+        
+        if( fseek( romfile, address, SEEK_SET ) || fread( cmd, 1, 8, romfile ) != 8 )
+        {
+            fprintf( stderr, "Display list runs past the end of the ROM at %08lX.\n", address );
+            return count;
+        }
+        address += 8;
+        
+        uint32_t w0 = (uint32_t)cmd[0] << 24 | cmd[1] << 16 | cmd[2] << 8 | cmd[3];
+        uint32_t w1 = (uint32_t)cmd[4] << 24 | cmd[5] << 16 | cmd[6] << 8 | cmd[7];
+        switch( cmd[0] )
+        {
+            case G_DL:
+            {
+                long target = segmented_to_rom( w1, segments );
+                if( target < 0 )
+                {
+                    break;
+                }
+                if( ((w0 >> 16) & 0xff) == 0 )  // G_DL_PUSH
+                {
+                    if( sp == DL_STACK_SIZE )
+                    {
+                        fprintf( stderr, "Display list stack overflow at %08lX.\n", address - 8 );
+                        return count;
+                    }
+                    stack[sp++] = address;
+                }
+                address = target;
+                break;
+            }
+            case G_ENDDL:
+            {
+                if( sp == 0 )
+                {
+                    return count;
+                }
+                address = stack[--sp];
+                break;
+            }
+            case G_SETTIMG:
+            {
+                timg = segmented_to_rom( w1, segments );
+                timg_depth = (w0 >> 19) & 3;
+                timg_width = (w0 & 0xfff) + 1;
+                break;
+            }
+            case G_SETTILE:
+            {
+                TILE *tile = &tiles[(w1 >> 24) & 7];
+                tile->format = (w0 >> 21) & 7;
+                tile->depth = (w0 >> 19) & 3;
+                tile->line = (w0 >> 9) & 0x1ff;
+                tile->tmem = w0 & 0x1ff;
+                tile->palette = (w1 >> 20) & 0xf;
+                break;
+            }
+            case G_LOADBLOCK:
+            {
+                load_tile = (w1 >> 24) & 7;
+                LOAD *load = &tmem[tiles[load_tile].tmem];
+                load->address = timg;
+                load->size = (long)(((w1 >> 12) & 0xfff) + 1) * bits_per_texel( timg_depth ) / 8;
+                load->stride = 0;
+                load->rows = 0;
+                break;
+            }
+            case G_LOADTILE:
+            {
+                load_tile = (w1 >> 24) & 7;
+                LOAD *load = &tmem[tiles[load_tile].tmem];
+                uint32_t ult = (w0 & 0xfff) >> 2;
+                uint32_t lrt = (w1 & 0xfff) >> 2;
+                // whole source rows are kept; the column offset is dropped
+                load->stride = timg_width * bits_per_texel( timg_depth ) / 8;
+                load->address = (timg < 0)? -1 : timg + (long)ult * load->stride;
+                load->rows = lrt - ult + 1;
+                load->size = (long)load->rows * load->stride;
+                break;
+            }
+            case G_LOADTLUT:
+            {
+                TILE *tile = &tiles[(w1 >> 24) & 7];
+                uint32_t colors = ((w1 >> 14) & 0x3ff) + 1;
+                if( tile->tmem < TLUT_BASE )
+                {
+                    break;
+                }
+                for( uint32_t i = 0; i * 16 < colors && (tile->tmem - TLUT_BASE) / 16 + i < 16; i++ )
+                {
+                    tlut[(tile->tmem - TLUT_BASE) / 16 + i] = (timg < 0)? -1 : timg + i * 32;
+                }
+                break;
+            }
+            case G_SETTILESIZE:
+            {
+                int index = (w1 >> 24) & 7;
+                TILE *tile = &tiles[index];
+                LOAD *load = &tmem[tile->tmem];
+                TEXJOB job;
+                
+                // the load tile gets a size too, but only the render tile describes the texture
+                if( index == load_tile || load->address < 0 || tile->line == 0 )
+                {
+                    break;
+                }
+                job.format = tile->format;
+                job.depth = tile->depth;
+                job.address = load->address;
+                job.paddress = -1;
+                job.pdepth = DEPTH_16BIT;
+                if( load->stride > 0 )
+                {
+                    job.width = load->stride * 8 / bits_per_texel( tile->depth );
+                    job.height = load->rows;
+                }
+                else
+                {
+                    // 32-bit texels are split across both halves of TMEM, so lines count 16 bits per texel
+                    job.width = tile->line * 64 / ((tile->depth == DEPTH_32BIT)? 16 : bits_per_texel( tile->depth ));
+                    job.height = load->size * 8 / ((long)job.width * bits_per_texel( tile->depth ));
+                }
+                int32_t height = ((((w1 & 0xfff) - (w0 & 0xfff)) & 0xfff) >> 2) + 1;
+                if( height < job.height )
+                {
+                    job.height = height;
+                }
+                if( job.width <= 0 || job.height <= 0 )
+                {
+                    break;
+                }
+                if( job.format == FORMAT_CI )
+                {
+                    job.paddress = tlut[(job.depth == DEPTH_4BIT)? tile->palette : 0];
+                    if( job.paddress < 0 )
+                    {
+                        fprintf( stderr, "No palette loaded for CI texture at %08lX.\n", job.address );
+                        break;
+                    }
+                }
+                else
+                {
+                    job.pdepth = -1;
+                }
+                count = add_job( jobs, count, &job );
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    fprintf( stderr, "Display list did not end after %d commands.\n", DL_MAX_COMMANDS );
+    return count;
+}
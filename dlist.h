@@ -0,0 +1,23 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+/* Walks F3D/F3DEX display lists and turns the texture loads it finds
+ * into export jobs. Segmented addresses are translated to ROM offsets
+ * through the segment table; unmapped segments are skipped. CI palettes
+ * are assumed to be RGBA16.
+ */
+
+#ifndef DLIST_H
+#define DLIST_H
+
+#include <stdio.h>
+#include "cli.h"
+
+#define SEGMENT_COUNT 16
+
+size_t walk_dlist( FILE *romfile, long address, const long *segments, TEXJOB **jobs );
+
+#endif
@@ -0,0 +1,175 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+#include <stddef.h>
+#include <string.h>
+#include "index.h"
+
+int read_rom_crc( FILE *romfile, uint32_t *crc )
+{
+    uint8_t temp[8];
+    
+    if( fseek( romfile, 0x10, SEEK_SET ) || fread( temp, 1, 8, romfile ) != 8 )
+    {
+        return -1;
+    }
+    crc[0] = (uint32_t)temp[0] << 24 | temp[1] << 16 | temp[2] << 8 | temp[3];
+    crc[1] = (uint32_t)temp[4] << 24 | temp[5] << 16 | temp[6] << 8 | temp[7];
+    return 0;
+}
+
+// With create set, a missing index is created for the ROM with the given
+// CRCs and the file is opened for update. A NULL crc skips the check.
+int open_index( ROMINDEX *index, const char *name, const uint32_t *crc, int create )
+{
+    long filesize;
+    
+    memset( index, 0, sizeof( ROMINDEX ) );
+    index->file = fopen( name, create? "r+b" : "rb" );
+    if( index->file == NULL && create && crc != NULL )
+    {
+        index->file = fopen( name, "w+b" );
+        if( index->file == NULL )
+        {
+            fprintf( stderr, "Could not open %s for writing.\n", name );
+            return -1;
+        }
+        index->header.magic = INDEX_MAGIC;
+        index->header.version = INDEX_VERSION;
+        index->header.recordsize = sizeof( INDEXRECORD );
+        index->header.crc1 = crc[0];
+        index->header.crc2 = crc[1];
+        if( fwrite( &index->header, sizeof( INDEXHEADER ), 1, index->file ) != 1 )
+        {
+            fprintf( stderr, "Failed to write index file.\n" );
+            return -1;
+        }
+        return 0;
+    }
+    if( index->file == NULL )
+    {
+        fprintf( stderr, "Could not open %s for reading.\n", name );
+        return -1;
+    }
+    
+    if( fread( &index->header, sizeof( INDEXHEADER ), 1, index->file ) != 1
+        || index->header.magic != INDEX_MAGIC || index->header.version != INDEX_VERSION
+        || index->header.recordsize != sizeof( INDEXRECORD ) )
+    {
+        fprintf( stderr, "Index file unsupported or invalid.\n" );
+        return -1;
+    }
+    if( crc != NULL && (index->header.crc1 != crc[0] || index->header.crc2 != crc[1]) )
+    {
+        fprintf( stderr, "Index file belongs to a different ROM.\n" );
+        return -1;
+    }
+    // the count comes from the file, so make sure it fits before sizing anything by it
+    if( fseek( index->file, 0, SEEK_END ) || (filesize = ftell( index->file )) < (long)sizeof( INDEXHEADER )
+        || fseek( index->file, sizeof( INDEXHEADER ), SEEK_SET )
+        || index->header.count > (unsigned long)(filesize - sizeof( INDEXHEADER )) / sizeof( INDEXRECORD ) )
+    {
+        fprintf( stderr, "Index file unsupported or invalid.\n" );
+        return -1;
+    }
+    index->capacity = index->header.count + 1;
+    index->records = checked_malloc( index->capacity * sizeof( INDEXRECORD ) );
+    if( fread( index->records, sizeof( INDEXRECORD ), index->header.count, index->file ) != index->header.count )
+    {
+        fprintf( stderr, "Failed to read index file.\n" );
+        return -1;
+    }
+    for( uint32_t i = 0; i < index->header.count; i++ )
+    {
+        const INDEXRECORD *record = &index->records[i];
+        if( record->format > FORMAT_I || record->depth > DEPTH_32BIT
+            || (record->format == FORMAT_CI && record->pdepth != DEPTH_16BIT && record->pdepth != DEPTH_32BIT) )
+        {
+            fprintf( stderr, "Index file unsupported or invalid.\n" );
+            return -1;
+        }
+    }
+    index->written = index->header.count;
+    return 0;
+}
+
+long add_index_record( ROMINDEX *index, const TEXJOB *job, uint64_t hash )
+{
+    INDEXRECORD record;
+    uint32_t count = index->header.count;
+    
+    if( job->address < 0 || job->address > UINT32_MAX || job->width > UINT16_MAX || job->height > UINT16_MAX )
+    {
+        return -1;
+    }
+    memset( &record, 0, sizeof( record ) );
+    record.address = job->address;
+    record.paddress = (job->format == FORMAT_CI)? (uint32_t)job->paddress : INDEX_NONE;
+    record.width = job->width;
+    record.height = job->height;
+    record.format = job->format;
+    record.depth = job->depth;
+    record.pdepth = (job->format == FORMAT_CI)? job->pdepth : 0xFF;
+    record.hash = hash;
+    
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        // the hash isn't part of the key, so a record can be refreshed
+        if( memcmp( &index->records[i], &record, offsetof( INDEXRECORD, hash ) ) == 0 )
+        {
+            if( index->records[i].hash != hash )
+            {
+                index->records[i].hash = hash;
+                if( i < index->written )
+                {
+                    index->written = i;
+                }
+            }
+            return i;
+        }
+    }
+    if( count == index->capacity )
+    {
+        index->capacity = (count < 8)? 16 : count * 2;
+        index->records = checked_realloc( index->records, index->capacity * sizeof( INDEXRECORD ) );
+    }
+    index->records[count] = record;
+    index->header.count++;
+    return count;
+}
+
+// Writes whatever changed since the index was opened, then the header.
+int close_index( ROMINDEX *index )
+{
+    int ret = 0;
+    
+    if( index->written < index->header.count )
+    {
+        if( fseek( index->file, sizeof( INDEXHEADER ) + index->written * sizeof( INDEXRECORD ), SEEK_SET )
+            || fwrite( index->records + index->written, sizeof( INDEXRECORD ),
+                index->header.count - index->written, index->file ) != index->header.count - index->written
+            || fseek( index->file, 0, SEEK_SET )
+            || fwrite( &index->header, sizeof( INDEXHEADER ), 1, index->file ) != 1 )
+        {
+            fprintf( stderr, "Failed to write index file.\n" );
+            ret = -1;
+        }
+    }
+    fclose( index->file );
+    free( index->records );
+    return ret;
+}
+
+void record_to_job( const INDEXRECORD *record, TEXJOB *job )
+{
+    job->format = record->format;
+    job->depth = record->depth;
+    job->pdepth = (record->format == FORMAT_CI)? (enum E_DEPTH)record->pdepth : (enum E_DEPTH)-1;
+    job->address = record->address;
+    job->paddress = (record->format == FORMAT_CI)? (long)record->paddress : -1;
+    job->width = record->width;
+    job->height = record->height;
+}
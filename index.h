@@ -0,0 +1,63 @@
+/* This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * the COPYING file for more details. */
+
+/* An index file remembers where the textures of one ROM are, so they
+ * can be listed and exported again without walking or scanning. The
+ * file is a header followed by fixed-size records, all little-endian,
+ * so it can be read with a single fread or mapped directly. A record's
+ * ID is its position in the file. New records are appended in place,
+ * and the header count is updated last, so an interrupted write loses
+ * at most the new records.
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdio.h>
+#include "cli.h"
+
+#define INDEX_MAGIC 0x5834364E  // "N64X"
+#define INDEX_VERSION 1
+#define INDEX_NONE 0xFFFFFFFF
+
+#pragma pack(push, 1)
+typedef struct {            // byte packing is mandatory
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordsize;    // sizeof( INDEXRECORD )
+    uint32_t crc1;          // from the ROM header, big-endian at 0x10
+    uint32_t crc2;          // from the ROM header, big-endian at 0x14
+    uint32_t count;
+} INDEXHEADER;
+
+typedef struct {
+    uint32_t address;
+    uint32_t paddress;      // INDEX_NONE unless CI
+    uint16_t width;
+    uint16_t height;
+    uint8_t format;         // enum E_FORMAT
+    uint8_t depth;          // enum E_DEPTH
+    uint8_t pdepth;         // enum E_DEPTH, 0xFF unless CI
+    uint8_t reserved;
+    uint64_t hash;          // hash_block() of the texture data
+} INDEXRECORD;
+#pragma pack(pop)
+
+typedef struct {
+    FILE *file;
+    INDEXHEADER header;
+    INDEXRECORD *records;
+    uint32_t capacity;      // records that fit in the records buffer
+    uint32_t written;       // records already in the file
+} ROMINDEX;
+
+int read_rom_crc( FILE *romfile, uint32_t *crc );
+int open_index( ROMINDEX *index, const char *name, const uint32_t *crc, int create );
+long add_index_record( ROMINDEX *index, const TEXJOB *job, uint64_t hash );
+int close_index( ROMINDEX *index );
+void record_to_job( const INDEXRECORD *record, TEXJOB *job );
+
+#endif
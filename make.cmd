@@ -1 +1 @@
-gcc -m32 -Wall -std=c11 -s -O4 -o n64rawgfx.exe cli.c n64rawgfx.c
+gcc -m32 -Wall -std=c11 -s -O4 -o n64rawgfx.exe bmp.c cli.c dedup.c dlist.c index.c n64rawgfx.c
@@ -275,3 +275,82 @@ void n64_import( enum E_FORMAT format, enum E_DEPTH depth, size_t count, const u
     }
     return;
 }
+
+void n64_expand_pal4( const uint32_t *pal, uint32_t *pairs )
+{
+    for( size_t i = 0; i < 256; i++ )
+    {
+        pairs[i * 2] = pal[i >> 4];
+        pairs[i * 2 + 1] = pal[i & 0x0f];
+    }
+    return;
+}
+
+void n64_export_ci4( size_t count, const uint8_t *in, uint32_t *out, const uint32_t *pairs )
+{
+    for( size_t i = 0; i < count; i+=2 )
+    {
+        const uint32_t *pair = pairs + in[i / 2] * 2;
+        out[i] = pair[0];
+        out[i + 1] = pair[1];
+    }
+    return;
+}
+
+static uint8_t *arena_align( void *ptr )
+{
+    return (uint8_t *)(((uintptr_t)ptr + N64_ARENA_ALIGN - 1) & ~(uintptr_t)(N64_ARENA_ALIGN - 1));
+}
+
+void *n64_arena_alloc( N64_ARENA *arena, size_t size )
+{
+    void *raw;
+    
+    // empty requests still take a slot so they never hand back a NULL block
+    size = (size)? (size + N64_ARENA_ALIGN - 1) & ~(size_t)(N64_ARENA_ALIGN - 1) : N64_ARENA_ALIGN;
+    arena->needed += size;
+    if( size <= arena->size - arena->used )
+    {
+        void *ret = arena->block + arena->used;
+        arena->used += size;
+        return ret;
+    }
+    raw = malloc( sizeof( void * ) + N64_ARENA_ALIGN + size );
+    if( raw == NULL )
+    {
+        return NULL;
+    }
+    *(void **)raw = arena->spill;
+    arena->spill = raw;
+    return arena_align( (uint8_t *)raw + sizeof( void * ) );
+}
+
+void n64_arena_reset( N64_ARENA *arena )
+{
+    while( arena->spill != NULL )
+    {
+        void *next = *(void **)arena->spill;
+        free( arena->spill );
+        arena->spill = next;
+    }
+    if( arena->needed > arena->size )
+    {
+        free( arena->raw );
+        arena->raw = malloc( arena->needed + N64_ARENA_ALIGN );
+        arena->block = arena_align( arena->raw );
+        arena->size = (arena->raw == NULL)? 0 : arena->needed;
+    }
+    arena->used = 0;
+    arena->needed = 0;
+    return;
+}
+
+void n64_arena_free( N64_ARENA *arena )
+{
+    n64_arena_reset( arena );
+    free( arena->raw );
+    arena->raw = NULL;
+    arena->block = NULL;
+    arena->size = 0;
+    return;
+}
@@ -15,11 +15,46 @@
  *  I       YES     YES     ------  ------
  */
 
+#ifndef N64RAWGFX_H
+#define N64RAWGFX_H
+
 #include <stdint.h>
 #include <stdlib.h>
 
 enum E_FORMAT { FORMAT_RGBA, FORMAT_YUV, FORMAT_CI, FORMAT_IA, FORMAT_I };
 enum E_DEPTH { DEPTH_4BIT, DEPTH_8BIT, DEPTH_16BIT, DEPTH_32BIT };
 
+/* A scratch arena for conversion buffers. A zeroed N64_ARENA is empty.
+ * Allocations are aligned to N64_ARENA_ALIGN bytes and stay valid until
+ * the next reset. When a round of allocations doesn't fit, the excess
+ * is allocated separately and the arena grows to the full size at the
+ * next reset, so repeating the same conversions stops allocating after
+ * the first round.
+ */
+
+#define N64_ARENA_ALIGN 64
+
+typedef struct {
+    void *raw;              // block as returned by malloc
+    uint8_t *block;         // aligned start of the block
+    size_t size;
+    size_t used;
+    size_t needed;          // bytes asked for since the last reset
+    void *spill;            // allocations that didn't fit, linked through their first word
+} N64_ARENA;
+
+void *n64_arena_alloc( N64_ARENA *arena, size_t size );
+void n64_arena_reset( N64_ARENA *arena );
+void n64_arena_free( N64_ARENA *arena );
+
 void n64_export( enum E_FORMAT format, enum E_DEPTH depth, size_t count, const uint8_t *in, uint32_t *out, const uint32_t *pal );
 void n64_import( enum E_FORMAT format, enum E_DEPTH depth, size_t count, const uint32_t *in, uint8_t *out );
+
+/* CI4 through a pair table: n64_expand_pal4 turns a 16-color palette into
+ * 256 pairs of pixels, one per source byte, so each byte of input is a
+ * single lookup. count must be even.
+ */
+void n64_expand_pal4( const uint32_t *pal, uint32_t *pairs );
+void n64_export_ci4( size_t count, const uint8_t *in, uint32_t *out, const uint32_t *pairs );
+
+#endif